@@ -1,5 +1,10 @@
+#include <algorithm>
+#include <string>
+#include <vector>
 #include "CppUnitTest.h"
 #include "threadpool.h"
+#include "tpalgorithms.h"
+#include "tppipeline.h"
 
 using namespace Microsoft::VisualStudio::CppUnitTestFramework;
 
@@ -49,7 +54,7 @@ namespace Tests
             MY_THREAD_POOL threadPool;
             MY_CONTEXT ctx;
             RtlZeroMemory(&ctx, sizeof(ctx));
-            InitializeSRWLock(&ctx.ContextLock);
+            ProfiledLockInitialize(&ctx.ContextLock);
 
             NTSTATUS status = TpInit(&threadPool, 2);
             Assert::IsTrue(NT_SUCCESS(status), L"Thread pool should initialize successfully");
@@ -66,4 +71,412 @@ namespace Tests
             Assert::IsTrue(ctx.Number > 0, L"Work items should be processed");
         }
     };
+
+    static void SquareTransformRoutine(const LONG64* Input, LONG64* Output, SIZE_T Count, PVOID Context)
+    {
+        UNREFERENCED_PARAMETER(Context);
+
+        for (SIZE_T i = 0; i < Count; ++i)
+        {
+            Output[i] = Input[i] * Input[i];
+        }
+    }
+
+    TEST_CLASS(ParallelAlgorithmsTests)
+    {
+    public:
+
+        /* Large enough to be split across the pool, with a remainder so chunks are uneven. */
+        static const SIZE_T ElementCount = TP_ALGO_SERIAL_CUTOFF * 8 + 7;
+
+        TEST_METHOD(TestParallelReduce)
+        {
+            MY_THREAD_POOL threadPool;
+            std::vector<LONG64> data(ElementCount);
+            for (SIZE_T i = 0; i < data.size(); ++i)
+            {
+                data[i] = (LONG64)i;
+            }
+
+            NTSTATUS status = TpInit(&threadPool, 4);
+            Assert::IsTrue(NT_SUCCESS(status), L"Thread pool should initialize successfully");
+
+            LONG64 sum = 0;
+            status = TpParallelReduce(&threadPool, data.data(), data.size(), &sum);
+            TpUninit(&threadPool);
+
+            Assert::IsTrue(NT_SUCCESS(status), L"Reduce should succeed");
+            Assert::IsTrue(sum == (LONG64)ElementCount * ((LONG64)ElementCount - 1) / 2, L"Reduce should return the sum of all elements");
+        }
+
+        TEST_METHOD(TestParallelScan)
+        {
+            MY_THREAD_POOL threadPool;
+            std::vector<LONG64> input(ElementCount, 1);
+            std::vector<LONG64> output(ElementCount, 0);
+
+            NTSTATUS status = TpInit(&threadPool, 4);
+            Assert::IsTrue(NT_SUCCESS(status), L"Thread pool should initialize successfully");
+
+            status = TpParallelScan(&threadPool, input.data(), output.data(), input.size());
+            TpUninit(&threadPool);
+
+            Assert::IsTrue(NT_SUCCESS(status), L"Scan should succeed");
+            for (SIZE_T i = 0; i < output.size(); ++i)
+            {
+                Assert::IsTrue(output[i] == (LONG64)(i + 1), L"Scan should produce the inclusive prefix sums");
+            }
+        }
+
+        TEST_METHOD(TestParallelSort)
+        {
+            MY_THREAD_POOL threadPool;
+            std::vector<LONG64> data(ElementCount);
+            for (SIZE_T i = 0; i < data.size(); ++i)
+            {
+                data[i] = (LONG64)((i * 7919) % 1009) - 500;
+            }
+            std::vector<LONG64> expected = data;
+            std::sort(expected.begin(), expected.end());
+
+            NTSTATUS status = TpInit(&threadPool, 3);
+            Assert::IsTrue(NT_SUCCESS(status), L"Thread pool should initialize successfully");
+
+            status = TpParallelSort(&threadPool, data.data(), data.size());
+            TpUninit(&threadPool);
+
+            Assert::IsTrue(NT_SUCCESS(status), L"Sort should succeed");
+            Assert::IsTrue(data == expected, L"Sort should match std::sort");
+        }
+
+        TEST_METHOD(TestParallelSortUnevenRuns)
+        {
+            /* 5, 6 and 7 runs don't pair evenly at every merge level. */
+            for (UINT32 numberOfThreads = 5; numberOfThreads <= 7; ++numberOfThreads)
+            {
+                MY_THREAD_POOL threadPool;
+                std::vector<LONG64> data(ElementCount);
+                UINT64 seed = 0x2545F4914F6CDD1DULL + numberOfThreads;
+                for (SIZE_T i = 0; i < data.size(); ++i)
+                {
+                    seed ^= seed << 13;
+                    seed ^= seed >> 7;
+                    seed ^= seed << 17;
+                    /* Narrow range so there are plenty of duplicates around the split points. */
+                    data[i] = (LONG64)(seed % 5000) - 2500;
+                }
+                std::vector<LONG64> expected = data;
+                std::sort(expected.begin(), expected.end());
+
+                NTSTATUS status = TpInit(&threadPool, numberOfThreads);
+                Assert::IsTrue(NT_SUCCESS(status), L"Thread pool should initialize successfully");
+
+                status = TpParallelSort(&threadPool, data.data(), data.size());
+                TpUninit(&threadPool);
+
+                Assert::IsTrue(NT_SUCCESS(status), L"Sort should succeed");
+                Assert::IsTrue(data == expected, L"Sort should match std::sort");
+            }
+        }
+
+        TEST_METHOD(TestParallelTransform)
+        {
+            MY_THREAD_POOL threadPool;
+            std::vector<LONG64> input(ElementCount);
+            std::vector<LONG64> output(ElementCount, 0);
+            for (SIZE_T i = 0; i < input.size(); ++i)
+            {
+                input[i] = (LONG64)i;
+            }
+
+            NTSTATUS status = TpInit(&threadPool, 4);
+            Assert::IsTrue(NT_SUCCESS(status), L"Thread pool should initialize successfully");
+
+            status = TpParallelTransform(&threadPool, input.data(), output.data(), input.size(), SquareTransformRoutine, NULL);
+            TpUninit(&threadPool);
+
+            Assert::IsTrue(NT_SUCCESS(status), L"Transform should succeed");
+            for (SIZE_T i = 0; i < output.size(); ++i)
+            {
+                Assert::IsTrue(output[i] == (LONG64)i * (LONG64)i, L"Transform should apply the routine to every element");
+            }
+        }
+
+        TEST_METHOD(TestParallelAlgorithmsSerialCutoff)
+        {
+            MY_THREAD_POOL threadPool;
+            LONG64 data[5] = { 5, 3, 1, 4, 2 };
+            LONG64 sum = 0;
+
+            NTSTATUS status = TpInit(&threadPool, 2);
+            Assert::IsTrue(NT_SUCCESS(status), L"Thread pool should initialize successfully");
+
+            status = TpParallelReduce(&threadPool, data, ARRAYSIZE(data), &sum);
+            Assert::IsTrue(NT_SUCCESS(status) && sum == 15, L"Small reduce should run serially and succeed");
+
+            status = TpParallelSort(&threadPool, data, ARRAYSIZE(data));
+            Assert::IsTrue(NT_SUCCESS(status) && data[0] == 1 && data[4] == 5, L"Small sort should run serially and succeed");
+
+            TpUninit(&threadPool);
+        }
+    };
+
+    static std::wstring CreateTempFilePath()
+    {
+        WCHAR directory[MAX_PATH];
+        WCHAR path[MAX_PATH];
+
+        GetTempPathW(MAX_PATH, directory);
+        GetTempFileNameW(directory, L"tpp", 0, path);
+
+        return path;
+    }
+
+    static void WriteWholeFile(const std::wstring& Path, const std::vector<BYTE>& Data)
+    {
+        HANDLE file = CreateFileW(Path.c_str(), GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+        Assert::IsTrue(INVALID_HANDLE_VALUE != file, L"Temp file should be created");
+
+        DWORD bytesWritten = 0;
+        if (!Data.empty())
+        {
+            WriteFile(file, Data.data(), (DWORD)Data.size(), &bytesWritten, NULL);
+        }
+        CloseHandle(file);
+
+        Assert::IsTrue(bytesWritten == Data.size(), L"Temp file should be written");
+    }
+
+    static std::vector<BYTE> ReadWholeFile(const std::wstring& Path)
+    {
+        HANDLE file = CreateFileW(Path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        Assert::IsTrue(INVALID_HANDLE_VALUE != file, L"Temp file should be opened");
+
+        LARGE_INTEGER size = { 0 };
+        GetFileSizeEx(file, &size);
+        std::vector<BYTE> data((SIZE_T)size.QuadPart);
+
+        DWORD bytesRead = 0;
+        if (!data.empty())
+        {
+            ReadFile(file, data.data(), (DWORD)data.size(), &bytesRead, NULL);
+        }
+        CloseHandle(file);
+
+        Assert::IsTrue(bytesRead == data.size(), L"Temp file should be read");
+        return data;
+    }
+
+    static NTSTATUS InvertTransformRoutine(const BYTE* Input, SIZE_T InputSize, BYTE* Output, SIZE_T OutputCapacity, SIZE_T* OutputSize, PVOID Context)
+    {
+        UNREFERENCED_PARAMETER(OutputCapacity);
+        UNREFERENCED_PARAMETER(Context);
+
+        for (SIZE_T i = 0; i < InputSize; ++i)
+        {
+            Output[i] = (BYTE)~Input[i];
+        }
+        *OutputSize = InputSize;
+
+        return STATUS_SUCCESS;
+    }
+
+    static NTSTATUS FailThirdChunkTransformRoutine(const BYTE* Input, SIZE_T InputSize, BYTE* Output, SIZE_T OutputCapacity, SIZE_T* OutputSize, PVOID Context)
+    {
+        if (3 == InterlockedIncrement((volatile LONG*)Context))
+        {
+            return STATUS_UNSUCCESSFUL;
+        }
+        return InvertTransformRoutine(Input, InputSize, Output, OutputCapacity, OutputSize, Context);
+    }
+
+    TEST_CLASS(PipelineTests)
+    {
+    public:
+
+        /* Uneven last chunk on purpose. */
+        static const SIZE_T ChunkSize = 4096;
+        static const SIZE_T FileSize = ChunkSize * 37 + 123;
+
+        static void RunInvertPipeline(bool UseMemoryMapping)
+        {
+            MY_THREAD_POOL threadPool;
+            TP_PIPELINE_CONFIG config;
+            TP_PIPELINE_STATS stats;
+            std::wstring inputPath = CreateTempFilePath();
+            std::wstring outputPath = CreateTempFilePath();
+
+            std::vector<BYTE> input(FileSize);
+            for (SIZE_T i = 0; i < input.size(); ++i)
+            {
+                input[i] = (BYTE)((i * 31) % 251);
+            }
+            WriteWholeFile(inputPath, input);
+
+            NTSTATUS status = TpInit(&threadPool, 4);
+            Assert::IsTrue(NT_SUCCESS(status), L"Thread pool should initialize successfully");
+
+            TpPipelineInitConfig(&config, InvertTransformRoutine, NULL);
+            config.ChunkSize = ChunkSize;
+            config.MaxInFlight = 3;
+            config.UseMemoryMapping = UseMemoryMapping;
+
+            status = TpPipelineProcessFile(&threadPool, inputPath.c_str(), outputPath.c_str(), &config, &stats);
+            TpUninit(&threadPool);
+
+            std::vector<BYTE> output = ReadWholeFile(outputPath);
+            DeleteFileW(inputPath.c_str());
+            DeleteFileW(outputPath.c_str());
+
+            Assert::IsTrue(NT_SUCCESS(status), L"Pipeline should succeed");
+            Assert::IsTrue(stats.MemoryMapped == UseMemoryMapping, L"Input should be mapped only when asked to");
+            Assert::IsTrue(stats.Chunks == 38, L"Input should be split in fixed-size chunks");
+            Assert::IsTrue(stats.BytesRead == FileSize && stats.BytesWritten == FileSize, L"Every byte should go through the pipeline");
+            Assert::IsTrue(output.size() == input.size(), L"Output should be as large as the input");
+            for (SIZE_T i = 0; i < output.size(); ++i)
+            {
+                Assert::IsTrue(output[i] == (BYTE)~input[i], L"Output should be transformed and in input order");
+            }
+        }
+
+        TEST_METHOD(TestPipelineReadFile)
+        {
+            RunInvertPipeline(false);
+        }
+
+        TEST_METHOD(TestPipelineMemoryMapped)
+        {
+            RunInvertPipeline(true);
+        }
+
+        TEST_METHOD(TestPipelineEmptyFile)
+        {
+            MY_THREAD_POOL threadPool;
+            TP_PIPELINE_CONFIG config;
+            TP_PIPELINE_STATS stats;
+            std::wstring inputPath = CreateTempFilePath();
+            std::wstring outputPath = CreateTempFilePath();
+
+            WriteWholeFile(inputPath, std::vector<BYTE>());
+
+            NTSTATUS status = TpInit(&threadPool, 2);
+            Assert::IsTrue(NT_SUCCESS(status), L"Thread pool should initialize successfully");
+
+            TpPipelineInitConfig(&config, InvertTransformRoutine, NULL);
+            status = TpPipelineProcessFile(&threadPool, inputPath.c_str(), outputPath.c_str(), &config, &stats);
+            TpUninit(&threadPool);
+
+            std::vector<BYTE> output = ReadWholeFile(outputPath);
+            DeleteFileW(inputPath.c_str());
+            DeleteFileW(outputPath.c_str());
+
+            Assert::IsTrue(NT_SUCCESS(status), L"Pipeline should succeed on an empty file");
+            Assert::IsTrue(stats.Chunks == 0, L"An empty file has no chunks");
+            Assert::IsTrue(output.empty(), L"Output should be empty");
+        }
+
+        TEST_METHOD(TestPipelineTransformFailure)
+        {
+            MY_THREAD_POOL threadPool;
+            TP_PIPELINE_CONFIG config;
+            volatile LONG chunksSeen = 0;
+            std::wstring inputPath = CreateTempFilePath();
+            std::wstring outputPath = CreateTempFilePath();
+
+            WriteWholeFile(inputPath, std::vector<BYTE>(FileSize, 0x5A));
+
+            NTSTATUS status = TpInit(&threadPool, 2);
+            Assert::IsTrue(NT_SUCCESS(status), L"Thread pool should initialize successfully");
+
+            TpPipelineInitConfig(&config, FailThirdChunkTransformRoutine, (PVOID)&chunksSeen);
+            config.ChunkSize = ChunkSize;
+            config.MaxInFlight = 2;
+            status = TpPipelineProcessFile(&threadPool, inputPath.c_str(), outputPath.c_str(), &config, NULL);
+            TpUninit(&threadPool);
+
+            std::vector<BYTE> output = ReadWholeFile(outputPath);
+            DeleteFileW(inputPath.c_str());
+            DeleteFileW(outputPath.c_str());
+
+            Assert::IsTrue(STATUS_UNSUCCESSFUL == status, L"The transform failure should be reported");
+            Assert::IsTrue(output.size() < FileSize, L"The pipeline should stop writing after a failure");
+        }
+    };
+
+#if WKDD_LOCK_PROFILING
+    typedef struct _CONTENDER_CONTEXT {
+        MY_PROFILED_LOCK* Lock;
+        HANDLE AboutToAcquireEvent;
+    } CONTENDER_CONTEXT;
+
+    static DWORD WINAPI AcquireProfiledLockRoutine(PVOID Context)
+    {
+        CONTENDER_CONTEXT* contender = (CONTENDER_CONTEXT*)(Context);
+        MY_PROFILED_LOCK scratchLock;
+
+        /* Sampling is counted per thread. Warm up so the next acquisition is the sampled one. */
+        ProfiledLockInitialize(&scratchLock);
+        for (int i = 0; i < LOCK_PROFILE_SAMPLE_INTERVAL - 1; ++i)
+        {
+            ProfiledLockAcquireExclusive(&scratchLock);
+            ProfiledLockReleaseExclusive(&scratchLock);
+        }
+
+        SetEvent(contender->AboutToAcquireEvent);
+        ProfiledLockAcquireExclusive(contender->Lock);
+        ProfiledLockReleaseExclusive(contender->Lock);
+
+        return STATUS_SUCCESS;
+    }
+
+    TEST_CLASS(LockProfilerTests)
+    {
+    public:
+
+        TEST_METHOD(TestProfiledLockUncontended)
+        {
+            MY_PROFILED_LOCK lock;
+            ProfiledLockInitialize(&lock);
+
+            for (int i = 0; i < 10 * LOCK_PROFILE_SAMPLE_INTERVAL; ++i)
+            {
+                ProfiledLockAcquireExclusive(&lock);
+                ProfiledLockReleaseExclusive(&lock);
+            }
+
+            Assert::IsTrue(lock.Acquisitions == 10 * LOCK_PROFILE_SAMPLE_INTERVAL, L"Every acquisition should be counted");
+            Assert::IsTrue(lock.Contentions == 0, L"A single thread should never contend");
+            Assert::IsTrue(lock.HoldSamples == 10, L"Every Nth acquisition should be sampled");
+            Assert::IsTrue(lock.CallSiteCount == 0, L"No call site should be recorded without contention");
+        }
+
+        TEST_METHOD(TestProfiledLockContended)
+        {
+            MY_PROFILED_LOCK lock;
+            ProfiledLockInitialize(&lock);
+
+            CONTENDER_CONTEXT contender = { &lock, CreateEventW(NULL, TRUE, FALSE, NULL) };
+            Assert::IsTrue(NULL != contender.AboutToAcquireEvent, L"Event should be created");
+
+            /* Hold the lock until the other thread is about to take it. */
+            ProfiledLockAcquireExclusive(&lock);
+            HANDLE thread = CreateThread(NULL, 0, AcquireProfiledLockRoutine, &contender, 0, NULL);
+            Assert::IsTrue(NULL != thread, L"Thread should be created");
+            WaitForSingleObject(contender.AboutToAcquireEvent, INFINITE);
+            Sleep(50);
+            ProfiledLockReleaseExclusive(&lock);
+
+            WaitForSingleObject(thread, INFINITE);
+            CloseHandle(thread);
+            CloseHandle(contender.AboutToAcquireEvent);
+
+            Assert::IsTrue(lock.Acquisitions == 2, L"Both acquisitions should be counted");
+            Assert::IsTrue(lock.Contentions == 1, L"The second thread should have contended");
+            Assert::IsTrue(lock.CallSiteCount == 1, L"The contended call site should be recorded");
+            Assert::IsTrue(lock.CallSites[0].Contentions == 1, L"The call site should have one contention");
+            Assert::IsTrue(lock.CallSites[0].WaitSamples == 1 && lock.CallSites[0].WaitTicks > 0, L"The contended wait should be sampled and timed");
+            Assert::IsTrue(lock.WaitSamples >= 1 && lock.WaitSamples == lock.HoldSamples, L"Every sampled acquisition should have a wait and a hold sample");
+        }
+    };
+#endif // WKDD_LOCK_PROFILING
 }
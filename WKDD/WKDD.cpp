@@ -3,7 +3,12 @@
 
 #include <iostream>
 #include <string>
+#include <vector>
+#include <algorithm>
+#include <numeric>
 #include "threadpool.h"
+#include "tpalgorithms.h"
+#include "tppipeline.h"
 #include "WKDD.h"
 
 bool g_IsThreadPoolRunning = false;
@@ -16,7 +21,7 @@ NTSTATUS RunWorkItems(_Inout_ MY_THREAD_POOL* tp, _Out_ MY_CONTEXT* ctx, _In_ UI
 {
     NTSTATUS status = STATUS_UNSUCCESSFUL;
 
-    InitializeSRWLock(&ctx->ContextLock);
+    ProfiledLockInitialize(&ctx->ContextLock);
     ctx->Number = 0;
 
     for (UINT32 i = 0; i < numItems; ++i)
@@ -32,11 +37,255 @@ NTSTATUS RunWorkItems(_Inout_ MY_THREAD_POOL* tp, _Out_ MY_CONTEXT* ctx, _In_ UI
     return STATUS_SUCCESS;
 }
 
+static void BenchTransformRoutine(_In_reads_(Count) const LONG64* Input, _Out_writes_(Count) LONG64* Output, _In_ SIZE_T Count, _In_opt_ PVOID Context)
+{
+    UNREFERENCED_PARAMETER(Context);
+
+    for (SIZE_T i = 0; i < Count; ++i)
+    {
+        Output[i] = Input[i] * 3 + 1;
+    }
+}
+
+static double ElapsedMilliseconds(_In_ const LARGE_INTEGER& Start, _In_ const LARGE_INTEGER& Frequency)
+{
+    LARGE_INTEGER end;
+    QueryPerformanceCounter(&end);
+    return (double)(end.QuadPart - Start.QuadPart) * 1000.0 / (double)Frequency.QuadPart;
+}
+
+static void PrintBenchmarkRow(_In_ const char* name, _In_ double serialMs, _In_ double parallelMs, _In_ NTSTATUS parallelStatus, _In_ bool matches)
+{
+    /* A failed run has no meaningful time or result. */
+    if (!NT_SUCCESS(parallelStatus))
+    {
+        printf("%-10s failed. Status: 0x%08X\n", name, parallelStatus);
+        return;
+    }
+    printf("%-10s %12.2f %12.2f %8.2fx%s\n", name, serialMs, parallelMs, serialMs / parallelMs,
+           matches ? "" : "  MISMATCH");
+}
+
+void RunAlgorithmBenchmarks(_Inout_ MY_THREAD_POOL* tp, _In_ SIZE_T count)
+{
+    LARGE_INTEGER frequency, start;
+    double serialMs = 0, parallelMs = 0;
+    LONG64 serialSum = 0, parallelSum = 0;
+    NTSTATUS parallelStatus = STATUS_UNSUCCESSFUL;
+
+    QueryPerformanceFrequency(&frequency);
+
+    std::vector<LONG64> input(count);
+    std::vector<LONG64> serialOutput(count);
+    std::vector<LONG64> parallelOutput(count);
+
+    /* Same pseudo random input for every run. */
+    UINT64 seed = 0x9E3779B97F4A7C15ULL;
+    for (SIZE_T i = 0; i < count; ++i)
+    {
+        seed ^= seed << 13;
+        seed ^= seed >> 7;
+        seed ^= seed << 17;
+        input[i] = (LONG64)(seed % 1000000);
+    }
+
+    printf("%-10s %12s %12s %9s\n", "algorithm", "serial (ms)", "pool (ms)", "speedup");
+
+    QueryPerformanceCounter(&start);
+    serialSum = std::accumulate(input.begin(), input.end(), (LONG64)0);
+    serialMs = ElapsedMilliseconds(start, frequency);
+    QueryPerformanceCounter(&start);
+    parallelStatus = TpParallelReduce(tp, input.data(), count, &parallelSum);
+    parallelMs = ElapsedMilliseconds(start, frequency);
+    PrintBenchmarkRow("reduce", serialMs, parallelMs, parallelStatus, serialSum == parallelSum);
+
+    QueryPerformanceCounter(&start);
+    std::partial_sum(input.begin(), input.end(), serialOutput.begin());
+    serialMs = ElapsedMilliseconds(start, frequency);
+    QueryPerformanceCounter(&start);
+    parallelStatus = TpParallelScan(tp, input.data(), parallelOutput.data(), count);
+    parallelMs = ElapsedMilliseconds(start, frequency);
+    PrintBenchmarkRow("scan", serialMs, parallelMs, parallelStatus, serialOutput == parallelOutput);
+
+    QueryPerformanceCounter(&start);
+    std::transform(input.begin(), input.end(), serialOutput.begin(), [](LONG64 x) { return x * 3 + 1; });
+    serialMs = ElapsedMilliseconds(start, frequency);
+    QueryPerformanceCounter(&start);
+    parallelStatus = TpParallelTransform(tp, input.data(), parallelOutput.data(), count, BenchTransformRoutine, NULL);
+    parallelMs = ElapsedMilliseconds(start, frequency);
+    PrintBenchmarkRow("transform", serialMs, parallelMs, parallelStatus, serialOutput == parallelOutput);
+
+    serialOutput = input;
+    parallelOutput = input;
+    QueryPerformanceCounter(&start);
+    std::sort(serialOutput.begin(), serialOutput.end());
+    serialMs = ElapsedMilliseconds(start, frequency);
+    QueryPerformanceCounter(&start);
+    parallelStatus = TpParallelSort(tp, parallelOutput.data(), count);
+    parallelMs = ElapsedMilliseconds(start, frequency);
+    PrintBenchmarkRow("sort", serialMs, parallelMs, parallelStatus, serialOutput == parallelOutput);
+}
+
+static NTSTATUS BenchPipelineTransformRoutine(_In_reads_bytes_(InputSize) const BYTE* Input, _In_ SIZE_T InputSize,
+                                              _Out_writes_bytes_(OutputCapacity) BYTE* Output, _In_ SIZE_T OutputCapacity,
+                                              _Out_ SIZE_T* OutputSize, _In_opt_ PVOID Context)
+{
+    UNREFERENCED_PARAMETER(OutputCapacity);
+    UNREFERENCED_PARAMETER(Context);
+
+    for (SIZE_T i = 0; i < InputSize; ++i)
+    {
+        Output[i] = Input[i] ^ 0x5A;
+    }
+    *OutputSize = InputSize;
+
+    return STATUS_SUCCESS;
+}
+
+static NTSTATUS RunPipelineOnce(_In_ UINT32 numThreads, _In_ PCWSTR inputPath, _In_ PCWSTR outputPath, _In_ bool useMemoryMapping, _Out_ double* mbps)
+{
+    MY_THREAD_POOL pool;
+    TP_PIPELINE_CONFIG config;
+    TP_PIPELINE_STATS stats;
+    LARGE_INTEGER frequency, start;
+
+    *mbps = 0;
+
+    NTSTATUS status = TpInit(&pool, numThreads);
+    if (!NT_SUCCESS(status))
+    {
+        return status;
+    }
+
+    TpPipelineInitConfig(&config, BenchPipelineTransformRoutine, NULL);
+    config.UseMemoryMapping = useMemoryMapping;
+
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&start);
+    NTSTATUS pipelineStatus = TpPipelineProcessFile(&pool, inputPath, outputPath, &config, &stats);
+    double elapsedMs = ElapsedMilliseconds(start, frequency);
+
+    TpUninit(&pool);
+
+    if (NT_SUCCESS(pipelineStatus) && 0 != elapsedMs)
+    {
+        *mbps = ((double)stats.BytesRead / (1024.0 * 1024.0)) / (elapsedMs / 1000.0);
+    }
+    return pipelineStatus;
+}
+
+static void PrintPipelineCell(_In_ NTSTATUS status, _In_ double mbps)
+{
+    /* A failed run has no meaningful throughput. */
+    if (!NT_SUCCESS(status))
+    {
+        printf(" failed. Status: 0x%08X", status);
+        return;
+    }
+    printf(" %14.1f", mbps);
+}
+
+static bool WriteBenchmarkInput(_In_ PCWSTR inputPath, _In_ UINT32 fileSizeMb)
+{
+    HANDLE inputFile = CreateFileW(inputPath, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (INVALID_HANDLE_VALUE == inputFile)
+    {
+        printf("Failed to open %ls. Error: %d\n", inputPath, GetLastError());
+        return false;
+    }
+
+    /* Fill the input with 1 MB blocks of pseudo random data. */
+    std::vector<BYTE> block(1024 * 1024);
+    UINT32 seed = 0x12345678;
+    bool written = true;
+    for (UINT32 mb = 0; mb < fileSizeMb && written; ++mb)
+    {
+        for (SIZE_T i = 0; i < block.size(); ++i)
+        {
+            seed = seed * 1664525 + 1013904223;
+            block[i] = (BYTE)(seed >> 24);
+        }
+
+        /* A short file would make the MB/s numbers meaningless. */
+        DWORD bytesWritten = 0;
+        if (!WriteFile(inputFile, block.data(), (DWORD)block.size(), &bytesWritten, NULL) || bytesWritten != block.size())
+        {
+            printf("Failed to write %ls. Error: %d\n", inputPath, GetLastError());
+            written = false;
+        }
+    }
+    CloseHandle(inputFile);
+
+    return written;
+}
+
+void RunPipelineBenchmark(_In_ UINT32 fileSizeMb)
+{
+    WCHAR directory[MAX_PATH];
+    WCHAR inputPath[MAX_PATH] = { 0 };
+    WCHAR outputPath[MAX_PATH] = { 0 };
+    const UINT32 threadCounts[] = { 1, 2, 4, 8 };
+
+    /* GetTempFileNameW creates the files, so they are deleted on every path below. */
+    if (0 == GetTempPathW(MAX_PATH, directory) ||
+        0 == GetTempFileNameW(directory, L"tpp", 0, inputPath) ||
+        0 == GetTempFileNameW(directory, L"tpp", 0, outputPath))
+    {
+        printf("Failed to create temp files. Error: %d\n", GetLastError());
+    }
+    else if (WriteBenchmarkInput(inputPath, fileSizeMb))
+    {
+        double mbps = 0;
+
+        /* Warm up the file cache so the first row is not penalized. */
+        NTSTATUS status = RunPipelineOnce(1, inputPath, outputPath, false, &mbps);
+        if (!NT_SUCCESS(status))
+        {
+            printf("Warm up run failed. Status: 0x%08X\n", status);
+        }
+        else
+        {
+            printf("%-8s %14s %14s\n", "threads", "read (MB/s)", "mapped (MB/s)");
+            for (UINT32 i = 0; i < ARRAYSIZE(threadCounts); ++i)
+            {
+                printf("%-8u", threadCounts[i]);
+                status = RunPipelineOnce(threadCounts[i], inputPath, outputPath, false, &mbps);
+                PrintPipelineCell(status, mbps);
+                status = RunPipelineOnce(threadCounts[i], inputPath, outputPath, true, &mbps);
+                PrintPipelineCell(status, mbps);
+                printf("\n");
+            }
+        }
+    }
+
+    if (0 != inputPath[0])
+    {
+        DeleteFileW(inputPath);
+    }
+    if (0 != outputPath[0])
+    {
+        DeleteFileW(outputPath);
+    }
+}
+
+void DumpLockStatistics()
+{
+#if WKDD_LOCK_PROFILING
+    ProfiledLockDump(&tp.QueueLock, "MY_THREAD_POOL::QueueLock");
+    ProfiledLockDump(&ctx.ContextLock, "MY_CONTEXT::ContextLock");
+#else
+    std::cout << "Lock profiling is disabled. Build with WKDD_LOCK_PROFILING=1 to enable it." << std::endl;
+#endif
+}
+
 void PrintHelp() {
     std::cout << "Available commands:" << std::endl;
     std::cout << "  help   - Show this message" << std::endl;
     std::cout << "  start  - Start the thread pool" << std::endl;
     std::cout << "  stop   - Stop the thread pool" << std::endl;
+    std::cout << "  bench  - Benchmark the pool algorithms against the serial std:: versions" << std::endl;
+    std::cout << "  lockstats - Show wait and hold statistics for the queue and context locks" << std::endl;
+    std::cout << "  pipebench - Measure file pipeline throughput in MB/s for 1 to 8 threads" << std::endl;
     std::cout << "  exit   - Exit the application" << std::endl;
 }
 
@@ -84,6 +333,22 @@ int main()
             std::cout << "Sending work to thread pool..." << std::endl;
             RunWorkItems(&tp, &ctx, 1000);
         }
+        else if (command == "bench") {
+            if (g_IsThreadPoolRunning) {
+                std::cout << "Benchmarking pool algorithms..." << std::endl;
+                RunAlgorithmBenchmarks(&tp, 1 << 24);
+            }
+            else {
+                std::cout << "Thread pool is not running." << std::endl;
+            }
+        }
+        else if (command == "lockstats") {
+            DumpLockStatistics();
+        }
+        else if (command == "pipebench") {
+            std::cout << "Benchmarking file pipeline..." << std::endl;
+            RunPipelineBenchmark(256);
+        }
         else if (command == "exit") {
             std::cout << "Exiting application..." << std::endl;
             break;
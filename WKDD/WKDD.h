@@ -11,6 +11,9 @@ extern MY_CONTEXT ctx;
 extern NTSTATUS status;
 
 NTSTATUS RunWorkItems(_Inout_ MY_THREAD_POOL* tp, _Out_ MY_CONTEXT* ctx, _In_ UINT32 numItems);
+void RunAlgorithmBenchmarks(_Inout_ MY_THREAD_POOL* tp, _In_ SIZE_T count);
+void RunPipelineBenchmark(_In_ UINT32 fileSizeMb);
+void DumpLockStatistics();
 void PrintHelp();
 
 #endif // WKDD_H
@@ -0,0 +1,210 @@
+#include <stdio.h>
+#include <string.h>
+#include "lockprofiler.h"
+
+#if WKDD_LOCK_PROFILING
+
+//
+// **********************************************************
+// *                   LOCK PROFILER API                    *
+// **********************************************************
+//
+
+/* Per thread acquisition counter, used to decide which acquisitions get timed. */
+static thread_local UINT32 g_LockSampleTick = 0;
+
+static LONG64
+ProfiledLockTimestamp()
+{
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    return now.QuadPart;
+}
+
+static void
+ProfiledLockRecordContention(
+    _Inout_ MY_PROFILED_LOCK* Lock,
+    _In_ PCSTR File,
+    _In_ UINT32 Line,
+    _In_ bool Sampled,
+    _In_ UINT64 WaitTicks
+)
+{
+    MY_LOCK_CALL_SITE* site = NULL;
+
+    Lock->Contentions++;
+
+    /* Call sites are string literals, so comparing the pointers is enough. */
+    for (UINT32 i = 0; i < Lock->CallSiteCount; ++i)
+    {
+        if (Lock->CallSites[i].File == File && Lock->CallSites[i].Line == Line)
+        {
+            site = &Lock->CallSites[i];
+            break;
+        }
+    }
+    if (NULL == site)
+    {
+        /* Table is full. Keep the totals right even if we cannot tell where from. */
+        if (Lock->CallSiteCount == LOCK_PROFILE_MAX_CALL_SITES)
+        {
+            Lock->UntrackedContentions++;
+            return;
+        }
+        site = &Lock->CallSites[Lock->CallSiteCount++];
+        site->File = File;
+        site->Line = Line;
+    }
+
+    site->Contentions++;
+    if (Sampled)
+    {
+        site->WaitSamples++;
+        site->WaitTicks += WaitTicks;
+    }
+}
+
+void
+ProfiledLockInitialize(
+    _Out_ MY_PROFILED_LOCK* Lock
+)
+{
+    RtlZeroMemory(Lock, sizeof(MY_PROFILED_LOCK));
+    InitializeSRWLock(&Lock->Lock);
+}
+
+void
+ProfiledLockAcquireExclusiveAt(
+    _Inout_ MY_PROFILED_LOCK* Lock,
+    _In_ PCSTR File,
+    _In_ UINT32 Line
+)
+{
+    bool sampled = (0 == (++g_LockSampleTick & (LOCK_PROFILE_SAMPLE_INTERVAL - 1)));
+    bool contended = false;
+    UINT64 waitTicks = 0;
+
+    /* Uncontended fast path - no clock reads unless this acquisition is sampled. */
+    if (!TryAcquireSRWLockExclusive(&Lock->Lock))
+    {
+        contended = true;
+
+        LONG64 waitStart = sampled ? ProfiledLockTimestamp() : 0;
+        AcquireSRWLockExclusive(&Lock->Lock);
+        if (sampled)
+        {
+            waitTicks = (UINT64)(ProfiledLockTimestamp() - waitStart);
+        }
+    }
+
+    /* From here on we own the lock, so the statistics need no atomics. */
+    Lock->Acquisitions++;
+    if (contended)
+    {
+        ProfiledLockRecordContention(Lock, File, Line, sampled, waitTicks);
+    }
+    if (sampled)
+    {
+        Lock->WaitSamples++;
+        Lock->WaitTicks += waitTicks;
+        if (waitTicks > Lock->MaxWaitTicks)
+        {
+            Lock->MaxWaitTicks = waitTicks;
+        }
+
+        /* Last thing before returning, so the hold time does not include our bookkeeping. */
+        Lock->HoldStart = ProfiledLockTimestamp();
+    }
+    else
+    {
+        Lock->HoldStart = 0;
+    }
+}
+
+void
+ProfiledLockReleaseExclusive(
+    _Inout_ MY_PROFILED_LOCK* Lock
+)
+{
+    /* Only sampled acquisitions have a hold start. */
+    if (0 != Lock->HoldStart)
+    {
+        UINT64 holdTicks = (UINT64)(ProfiledLockTimestamp() - Lock->HoldStart);
+
+        Lock->HoldSamples++;
+        Lock->HoldTicks += holdTicks;
+        if (holdTicks > Lock->MaxHoldTicks)
+        {
+            Lock->MaxHoldTicks = holdTicks;
+        }
+        Lock->HoldStart = 0;
+    }
+
+    ReleaseSRWLockExclusive(&Lock->Lock);
+}
+
+void
+ProfiledLockDump(
+    _Inout_ MY_PROFILED_LOCK* Lock,
+    _In_ PCSTR Name
+)
+{
+    MY_PROFILED_LOCK snapshot;
+    LARGE_INTEGER frequency;
+
+    /* Copy the statistics under the lock so the report is consistent. */
+    AcquireSRWLockExclusive(&Lock->Lock);
+    snapshot = *Lock;
+    ReleaseSRWLockExclusive(&Lock->Lock);
+
+    QueryPerformanceFrequency(&frequency);
+    double usPerTick = 1000000.0 / (double)frequency.QuadPart;
+
+    printf("Lock %s:\n", Name);
+    printf("  acquisitions    : %llu\n", snapshot.Acquisitions);
+    printf("  contentions     : %llu (%.2f%%)\n", snapshot.Contentions,
+           (0 != snapshot.Acquisitions) ? 100.0 * (double)snapshot.Contentions / (double)snapshot.Acquisitions : 0.0);
+    printf("  avg / max wait  : %.3f / %.3f us (%llu samples)\n",
+           (0 != snapshot.WaitSamples) ? (double)snapshot.WaitTicks * usPerTick / (double)snapshot.WaitSamples : 0.0,
+           (double)snapshot.MaxWaitTicks * usPerTick, snapshot.WaitSamples);
+    printf("  avg / max hold  : %.3f / %.3f us (%llu samples)\n",
+           (0 != snapshot.HoldSamples) ? (double)snapshot.HoldTicks * usPerTick / (double)snapshot.HoldSamples : 0.0,
+           (double)snapshot.MaxHoldTicks * usPerTick, snapshot.HoldSamples);
+
+    if (0 == snapshot.CallSiteCount)
+    {
+        return;
+    }
+
+    /* Sort the call sites by contention count, most contended first. */
+    for (UINT32 i = 1; i < snapshot.CallSiteCount; ++i)
+    {
+        MY_LOCK_CALL_SITE site = snapshot.CallSites[i];
+        UINT32 j = i;
+        while (j > 0 && snapshot.CallSites[j - 1].Contentions < site.Contentions)
+        {
+            snapshot.CallSites[j] = snapshot.CallSites[j - 1];
+            --j;
+        }
+        snapshot.CallSites[j] = site;
+    }
+
+    printf("  top contended call sites:\n");
+    for (UINT32 i = 0; i < snapshot.CallSiteCount && i < LOCK_PROFILE_TOP_CALL_SITES; ++i)
+    {
+        const MY_LOCK_CALL_SITE* site = &snapshot.CallSites[i];
+
+        /* Only print the file name, __FILE__ may be a full path. */
+        PCSTR fileName = strrchr(site->File, '\\');
+        fileName = (NULL != fileName) ? fileName + 1 : site->File;
+
+        printf("    %s:%u - %llu contentions, avg wait %.3f us\n", fileName, site->Line, site->Contentions,
+               (0 != site->WaitSamples) ? (double)site->WaitTicks * usPerTick / (double)site->WaitSamples : 0.0);
+    }
+    if (0 != snapshot.UntrackedContentions)
+    {
+        printf("    (other sites) - %llu contentions\n", snapshot.UntrackedContentions);
+    }
+}
+
+#endif // WKDD_LOCK_PROFILING
@@ -0,0 +1,73 @@
+#ifndef LOCKPROFILER_H
+#define LOCKPROFILER_H
+
+#define WIN32_NO_STATUS
+#include <Windows.h>
+#undef WIN32_NO_STATUS
+
+// **********************************************************
+// *                   LOCK PROFILER API                    *
+// **********************************************************
+
+// Set WKDD_LOCK_PROFILING to 1 in the project settings to turn the profiler on.
+#ifndef WKDD_LOCK_PROFILING
+#define WKDD_LOCK_PROFILING 0
+#endif
+
+// Every Nth acquisition made by a thread reads the clock. Must be a power of two.
+#define LOCK_PROFILE_SAMPLE_INTERVAL    16
+
+// Number of distinct contended call sites remembered per lock.
+#define LOCK_PROFILE_MAX_CALL_SITES     16
+
+// Number of call sites printed by ProfiledLockDump.
+#define LOCK_PROFILE_TOP_CALL_SITES     5
+
+#if WKDD_LOCK_PROFILING
+
+// MY_LOCK_CALL_SITE - A place in the code that had to wait for the lock
+typedef struct _MY_LOCK_CALL_SITE {
+    PCSTR File;
+    UINT32 Line;
+    UINT64 Contentions;
+    UINT64 WaitSamples;
+    UINT64 WaitTicks;
+} MY_LOCK_CALL_SITE;
+
+// MY_PROFILED_LOCK - SRWLOCK that keeps wait and hold statistics
+typedef struct _MY_PROFILED_LOCK {
+    SRWLOCK Lock;
+    UINT64 Acquisitions;
+    UINT64 Contentions;
+    UINT64 WaitSamples;
+    UINT64 WaitTicks;
+    UINT64 MaxWaitTicks;
+    UINT64 HoldSamples;
+    UINT64 HoldTicks;
+    UINT64 MaxHoldTicks;
+    LONG64 HoldStart;
+    UINT64 UntrackedContentions;
+    UINT32 CallSiteCount;
+    MY_LOCK_CALL_SITE CallSites[LOCK_PROFILE_MAX_CALL_SITES];
+} MY_PROFILED_LOCK;
+
+void ProfiledLockInitialize(_Out_ MY_PROFILED_LOCK* Lock);
+void ProfiledLockAcquireExclusiveAt(_Inout_ MY_PROFILED_LOCK* Lock, _In_ PCSTR File, _In_ UINT32 Line);
+void ProfiledLockReleaseExclusive(_Inout_ MY_PROFILED_LOCK* Lock);
+void ProfiledLockDump(_Inout_ MY_PROFILED_LOCK* Lock, _In_ PCSTR Name);
+
+#define ProfiledLockAcquireExclusive(Lock)  ProfiledLockAcquireExclusiveAt((Lock), __FILE__, __LINE__)
+
+#else // WKDD_LOCK_PROFILING
+
+// Profiling disabled - the profiled lock is the bare SRWLOCK.
+typedef SRWLOCK MY_PROFILED_LOCK;
+
+#define ProfiledLockInitialize(Lock)        InitializeSRWLock(Lock)
+#define ProfiledLockAcquireExclusive(Lock)  AcquireSRWLockExclusive(Lock)
+#define ProfiledLockReleaseExclusive(Lock)  ReleaseSRWLockExclusive(Lock)
+#define ProfiledLockDump(Lock, Name)        ((void)(Lock), (void)(Name))
+
+#endif // WKDD_LOCK_PROFILING
+
+#endif // LOCKPROFILER_H
@@ -11,6 +11,8 @@
 #include <assert.h>
 #include <crtdbg.h>
 
+#include "lockprofiler.h"
+
 
 //
 // **********************************************************
@@ -143,7 +145,7 @@ typedef struct _MY_THREAD_POOL
     /* List of threads started in thread pool. */
     HANDLE* ThreadHandles;
     /* The list of work items and the mutex  protecting. */
-    SRWLOCK QueueLock;
+    MY_PROFILED_LOCK QueueLock;
     /* Enqueued work items - represented as a double linked list. */
     LIST_ENTRY Queue;
 } MY_THREAD_POOL;
@@ -199,7 +201,7 @@ TpRoutine(
                 MY_WORK_ITEM* workItem = NULL;
 
                 /* Take the lock to safely access the queue. */
-                AcquireSRWLockExclusive(&threadPool->QueueLock);
+                ProfiledLockAcquireExclusive(&threadPool->QueueLock);
 
                 /* Try to pop one element from the queue. */
                 if (!ListIsEmpty(&threadPool->Queue))
@@ -210,7 +212,7 @@ TpRoutine(
                 }
 
                 /* Release the lock after removing the item. */
-                ReleaseSRWLockExclusive(&threadPool->QueueLock);
+                ProfiledLockReleaseExclusive(&threadPool->QueueLock);
 
                 /* If we have an item, invoke the work routine. */
                 if (workItem != NULL)
@@ -281,7 +283,7 @@ TpUninit(
     if (!ListIsEmpty(&ThreadPool->Queue))
     {
         /* Acquire the lock to safely access the work queue. */
-        AcquireSRWLockExclusive(&ThreadPool->QueueLock);
+        ProfiledLockAcquireExclusive(&ThreadPool->QueueLock);
 
         while (!ListIsEmpty(&ThreadPool->Queue))
         {
@@ -297,7 +299,7 @@ TpUninit(
         }
 
         /* Release the lock after emptying the queue. */
-        ReleaseSRWLockExclusive(&ThreadPool->QueueLock);
+        ProfiledLockReleaseExclusive(&ThreadPool->QueueLock);
     }
 
     /* Close the event handles. */
@@ -334,7 +336,7 @@ TpInit(
 
     /* Initialize the work queue. */
     ListInitializeHead(&ThreadPool->Queue);
-    InitializeSRWLock(&ThreadPool->QueueLock);
+    ProfiledLockInitialize(&ThreadPool->QueueLock);
 
     /* Initialize stop event - once set, this will remain signaled as it needs to notify all threads. */
     ThreadPool->StopThreadPoolEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
@@ -421,7 +423,7 @@ TpEnqueueWorkItem(
     item->WorkRoutine = WorkRoutine;
 
     /* Lock the thread pool to safely add the work item to the queue. */
-    AcquireSRWLockExclusive(&ThreadPool->QueueLock); // using SRWLOCK-specific function
+    ProfiledLockAcquireExclusive(&ThreadPool->QueueLock);
 
     /* Insert the work item at the head of the thread pool's queue. */
     ListInsertHead(&ThreadPool->Queue, &item->ListEntry); // Use ListInsertHead for head insertion
@@ -430,7 +432,7 @@ TpEnqueueWorkItem(
     SetEvent(ThreadPool->WorkScheduledEvent);
 
     /* Unlock after inserting the work item. */
-    ReleaseSRWLockExclusive(&ThreadPool->QueueLock); // using SRWLOCK-specific function
+    ProfiledLockReleaseExclusive(&ThreadPool->QueueLock);
 
     /* All good. */
     return STATUS_SUCCESS;
@@ -444,7 +446,7 @@ TpEnqueueWorkItem(
 //
 typedef struct _MY_CONTEXT
 {
-    SRWLOCK ContextLock;
+    MY_PROFILED_LOCK ContextLock;
     UINT32 Number;
 } MY_CONTEXT;
 
@@ -461,9 +463,9 @@ TestThreadPoolRoutine(
 
     for (UINT32 i = 0; i < 1000; ++i)
     {
-        AcquireSRWLockExclusive(&ctx->ContextLock);
+        ProfiledLockAcquireExclusive(&ctx->ContextLock);
         ctx->Number++;
-        ReleaseSRWLockExclusive(&ctx->ContextLock);
+        ProfiledLockReleaseExclusive(&ctx->ContextLock);
     }
 
     return STATUS_SUCCESS;
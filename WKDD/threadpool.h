@@ -12,6 +12,8 @@
 #include <assert.h>
 #include <crtdbg.h>
 
+#include "lockprofiler.h"
+
 // **********************************************************
 // *                        LIST API                        *
 // **********************************************************
@@ -30,7 +32,7 @@ typedef struct _MY_THREAD_POOL {
     HANDLE WorkScheduledEvent;
     UINT32 NumberOfThreads;
     HANDLE* ThreadHandles;
-    SRWLOCK QueueLock;
+    MY_PROFILED_LOCK QueueLock;
     LIST_ENTRY Queue;
 } MY_THREAD_POOL;
 
@@ -50,7 +52,7 @@ NTSTATUS TpEnqueueWorkItem(_Inout_ MY_THREAD_POOL* ThreadPool, _In_ LPTHREAD_STA
 // *                        Testing API                     *
 // **********************************************************
 typedef struct _MY_CONTEXT {
-    SRWLOCK ContextLock;
+    MY_PROFILED_LOCK ContextLock;
     UINT32 Number;
 } MY_CONTEXT;
 
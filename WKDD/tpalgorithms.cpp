@@ -0,0 +1,612 @@
+#include <algorithm>
+#include "tpalgorithms.h"
+
+
+//
+// **********************************************************
+// *                   TP ALGORITHMS API                    *
+// **********************************************************
+//
+
+//
+// TP_ALGO_BATCH - tracks a group of work items the caller is waiting on
+//
+typedef struct _TP_ALGO_BATCH
+{
+    /* Number of chunks that did not finish yet. */
+    volatile LONG Pending;
+    /* Signaled by the chunk that brings Pending to zero. */
+    HANDLE DoneEvent;
+} TP_ALGO_BATCH;
+
+//
+// TP_ALGO_CHUNK - one contiguous slice of the input, processed by a single work item
+//
+typedef struct _TP_ALGO_CHUNK
+{
+    /* Batch this chunk belongs to. */
+    TP_ALGO_BATCH* Batch;
+    /* Slice of the input. For merges this is the left run. */
+    const LONG64* Input;
+    SIZE_T Count;
+    /* Right run, only used when merging. */
+    const LONG64* Right;
+    SIZE_T RightCount;
+    /* Where the results are written. */
+    LONG64* Output;
+    /* Partial sum for reduce, starting offset for scan. */
+    LONG64 Value;
+    /* Caller routine for transform. */
+    TP_TRANSFORM_ROUTINE TransformRoutine;
+    PVOID Context;
+} TP_ALGO_CHUNK;
+
+static LONG64
+TpAlgoSumRange(
+    _In_reads_(Count) const LONG64* Data,
+    _In_ SIZE_T Count
+)
+{
+    /*
+     * Independent accumulators break the dependency chain on a single sum,
+     * so the compiler can keep them in vector lanes.
+     */
+    LONG64 sum0 = 0, sum1 = 0, sum2 = 0, sum3 = 0;
+    SIZE_T i = 0;
+
+    for (; i + 4 <= Count; i += 4)
+    {
+        sum0 += Data[i];
+        sum1 += Data[i + 1];
+        sum2 += Data[i + 2];
+        sum3 += Data[i + 3];
+    }
+    for (; i < Count; ++i)
+    {
+        sum0 += Data[i];
+    }
+
+    return (sum0 + sum1) + (sum2 + sum3);
+}
+
+static void
+TpAlgoScanRange(
+    _In_reads_(Count) const LONG64* Input,
+    _Out_writes_(Count) LONG64* Output,
+    _In_ SIZE_T Count,
+    _In_ LONG64 Offset
+)
+{
+    LONG64 running = Offset;
+    for (SIZE_T i = 0; i < Count; ++i)
+    {
+        running += Input[i];
+        Output[i] = running;
+    }
+}
+
+static void
+TpAlgoCompleteChunk(
+    _Inout_ TP_ALGO_CHUNK* Chunk
+)
+{
+    /* Last chunk out wakes up the caller. */
+    if (0 == InterlockedDecrement(&Chunk->Batch->Pending))
+    {
+        SetEvent(Chunk->Batch->DoneEvent);
+    }
+}
+
+static DWORD WINAPI
+TpAlgoReduceRoutine(
+    _In_opt_ PVOID Context
+)
+{
+    TP_ALGO_CHUNK* chunk = (TP_ALGO_CHUNK*)(Context);
+
+    chunk->Value = TpAlgoSumRange(chunk->Input, chunk->Count);
+    TpAlgoCompleteChunk(chunk);
+
+    return STATUS_SUCCESS;
+}
+
+static DWORD WINAPI
+TpAlgoScanRoutine(
+    _In_opt_ PVOID Context
+)
+{
+    TP_ALGO_CHUNK* chunk = (TP_ALGO_CHUNK*)(Context);
+
+    TpAlgoScanRange(chunk->Input, chunk->Output, chunk->Count, chunk->Value);
+    TpAlgoCompleteChunk(chunk);
+
+    return STATUS_SUCCESS;
+}
+
+static DWORD WINAPI
+TpAlgoSortRoutine(
+    _In_opt_ PVOID Context
+)
+{
+    TP_ALGO_CHUNK* chunk = (TP_ALGO_CHUNK*)(Context);
+
+    std::sort(chunk->Output, chunk->Output + chunk->Count);
+    TpAlgoCompleteChunk(chunk);
+
+    return STATUS_SUCCESS;
+}
+
+static DWORD WINAPI
+TpAlgoMergeRoutine(
+    _In_opt_ PVOID Context
+)
+{
+    TP_ALGO_CHUNK* chunk = (TP_ALGO_CHUNK*)(Context);
+
+    /* A run without a partner (RightCount == 0) is simply copied over. */
+    std::merge(chunk->Input, chunk->Input + chunk->Count,
+               chunk->Right, chunk->Right + chunk->RightCount,
+               chunk->Output);
+    TpAlgoCompleteChunk(chunk);
+
+    return STATUS_SUCCESS;
+}
+
+static DWORD WINAPI
+TpAlgoTransformRoutine(
+    _In_opt_ PVOID Context
+)
+{
+    TP_ALGO_CHUNK* chunk = (TP_ALGO_CHUNK*)(Context);
+
+    chunk->TransformRoutine(chunk->Input, chunk->Output, chunk->Count, chunk->Context);
+    TpAlgoCompleteChunk(chunk);
+
+    return STATUS_SUCCESS;
+}
+
+static UINT32
+TpAlgoChunkCount(
+    _In_ const MY_THREAD_POOL* ThreadPool,
+    _In_ SIZE_T Count
+)
+{
+    /* One chunk per thread, as long as every chunk gets a meaningful amount of work. */
+    SIZE_T chunkCount = Count / TP_ALGO_MIN_CHUNK;
+    if (chunkCount > ThreadPool->NumberOfThreads)
+    {
+        chunkCount = ThreadPool->NumberOfThreads;
+    }
+    if (0 == chunkCount)
+    {
+        chunkCount = 1;
+    }
+    return (UINT32)chunkCount;
+}
+
+static bool
+TpAlgoRunSerially(
+    _In_ const MY_THREAD_POOL* ThreadPool,
+    _In_ SIZE_T Count
+)
+{
+    return (Count < TP_ALGO_SERIAL_CUTOFF) || (ThreadPool->NumberOfThreads < 2);
+}
+
+static TP_ALGO_CHUNK*
+TpAlgoAllocateChunks(
+    _In_ UINT32 ChunkCount,
+    _In_reads_opt_(Count) const LONG64* Input,
+    _In_opt_ LONG64* Output,
+    _In_ SIZE_T Count
+)
+{
+    TP_ALGO_CHUNK* chunks = (TP_ALGO_CHUNK*)malloc(ChunkCount * sizeof(TP_ALGO_CHUNK));
+    if (NULL == chunks)
+    {
+        return NULL;
+    }
+    RtlZeroMemory(chunks, ChunkCount * sizeof(TP_ALGO_CHUNK));
+
+    /* Split [0, Count) into ChunkCount contiguous slices, spreading the remainder over the first ones. */
+    SIZE_T baseCount = Count / ChunkCount;
+    SIZE_T remainder = Count % ChunkCount;
+    SIZE_T offset = 0;
+    for (UINT32 i = 0; i < ChunkCount; ++i)
+    {
+        chunks[i].Count = baseCount + ((i < remainder) ? 1 : 0);
+        chunks[i].Input = (NULL != Input) ? Input + offset : NULL;
+        chunks[i].Output = (NULL != Output) ? Output + offset : NULL;
+        offset += chunks[i].Count;
+    }
+
+    return chunks;
+}
+
+static SIZE_T
+TpAlgoMergeSplit(
+    _In_reads_(LeftCount) const LONG64* Left,
+    _In_ SIZE_T LeftCount,
+    _In_reads_(RightCount) const LONG64* Right,
+    _In_ SIZE_T RightCount,
+    _In_ SIZE_T Diagonal
+)
+{
+    /*
+     * Returns how many of the first Diagonal merged elements come from Left (the co-rank).
+     * The rest, Diagonal minus the result, come from Right. Ties go to Left, like std::merge.
+     */
+    SIZE_T low = (Diagonal > RightCount) ? Diagonal - RightCount : 0;
+    SIZE_T high = (Diagonal < LeftCount) ? Diagonal : LeftCount;
+
+    while (low < high)
+    {
+        SIZE_T middle = low + (high - low) / 2;
+        if (Left[middle] <= Right[Diagonal - middle - 1])
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+
+    return low;
+}
+
+static UINT32
+TpAlgoSliceMerge(
+    _In_reads_(LeftCount) const LONG64* Left,
+    _In_ SIZE_T LeftCount,
+    _In_reads_opt_(RightCount) const LONG64* Right,
+    _In_ SIZE_T RightCount,
+    _Out_writes_(LeftCount + RightCount) LONG64* Output,
+    _In_ SIZE_T SliceSize,
+    _Out_ TP_ALGO_CHUNK* Slices
+)
+{
+    /*
+     * Cuts the merge of Left and Right into independent slices of about SliceSize output elements.
+     * Every slice merges its own part of both runs into its own part of Output.
+     */
+    SIZE_T totalCount = LeftCount + RightCount;
+    UINT32 sliceCount = (UINT32)((totalCount + SliceSize - 1) / SliceSize);
+    SIZE_T leftSplit = 0;
+
+    for (UINT32 i = 0; i < sliceCount; ++i)
+    {
+        SIZE_T diagonalStart = i * SliceSize;
+        SIZE_T diagonalEnd = (diagonalStart + SliceSize < totalCount) ? diagonalStart + SliceSize : totalCount;
+        SIZE_T nextLeftSplit = TpAlgoMergeSplit(Left, LeftCount, Right, RightCount, diagonalEnd);
+
+        RtlZeroMemory(&Slices[i], sizeof(TP_ALGO_CHUNK));
+        Slices[i].Input = Left + leftSplit;
+        Slices[i].Count = nextLeftSplit - leftSplit;
+        Slices[i].Right = (NULL != Right) ? Right + (diagonalStart - leftSplit) : NULL;
+        Slices[i].RightCount = (diagonalEnd - nextLeftSplit) - (diagonalStart - leftSplit);
+        Slices[i].Output = Output + diagonalStart;
+
+        leftSplit = nextLeftSplit;
+    }
+
+    return sliceCount;
+}
+
+static NTSTATUS
+TpAlgoRunBatch(
+    _Inout_ MY_THREAD_POOL* ThreadPool,
+    _In_ LPTHREAD_START_ROUTINE WorkRoutine,
+    _Inout_updates_(ChunkCount) TP_ALGO_CHUNK* Chunks,
+    _In_ UINT32 ChunkCount
+)
+{
+    TP_ALGO_BATCH batch = { 0 };
+
+    /* Manual reset, so a late SetEvent can never be missed by the wait below. */
+    batch.DoneEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+    if (NULL == batch.DoneEvent)
+    {
+        return STATUS_INVALID_HANDLE;
+    }
+    batch.Pending = (LONG)ChunkCount;
+
+    for (UINT32 i = 0; i < ChunkCount; ++i)
+    {
+        Chunks[i].Batch = &batch;
+
+        /* If the pool cannot take the chunk, process it here. The batch still completes. */
+        if (!NT_SUCCESS(TpEnqueueWorkItem(ThreadPool, WorkRoutine, &Chunks[i])))
+        {
+            WorkRoutine(&Chunks[i]);
+        }
+    }
+
+    WaitForSingleObject(batch.DoneEvent, INFINITE);
+    CloseHandle(batch.DoneEvent);
+
+    return STATUS_SUCCESS;
+}
+
+NTSTATUS
+TpParallelReduce(
+    _Inout_ MY_THREAD_POOL* ThreadPool,
+    _In_reads_(Count) const LONG64* Data,
+    _In_ SIZE_T Count,
+    _Out_ LONG64* Sum
+)
+{
+    NTSTATUS status = STATUS_UNSUCCESSFUL;
+
+    /* Sanity checks for parameters. */
+    if (NULL == ThreadPool || NULL == Sum || (NULL == Data && 0 != Count))
+    {
+        return STATUS_INVALID_PARAMETER;
+    }
+    *Sum = 0;
+
+    /* Small inputs are not worth the scheduling overhead. */
+    if (TpAlgoRunSerially(ThreadPool, Count))
+    {
+        *Sum = TpAlgoSumRange(Data, Count);
+        return STATUS_SUCCESS;
+    }
+
+    UINT32 chunkCount = TpAlgoChunkCount(ThreadPool, Count);
+    TP_ALGO_CHUNK* chunks = TpAlgoAllocateChunks(chunkCount, Data, NULL, Count);
+    if (NULL == chunks)
+    {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    status = TpAlgoRunBatch(ThreadPool, TpAlgoReduceRoutine, chunks, chunkCount);
+    if (NT_SUCCESS(status))
+    {
+        /* Combine the partial sums. */
+        for (UINT32 i = 0; i < chunkCount; ++i)
+        {
+            *Sum += chunks[i].Value;
+        }
+    }
+
+    free(chunks);
+    return status;
+}
+
+NTSTATUS
+TpParallelScan(
+    _Inout_ MY_THREAD_POOL* ThreadPool,
+    _In_reads_(Count) const LONG64* Input,
+    _Out_writes_(Count) LONG64* Output,
+    _In_ SIZE_T Count
+)
+{
+    NTSTATUS status = STATUS_UNSUCCESSFUL;
+
+    /* Sanity checks for parameters. */
+    if (NULL == ThreadPool || ((NULL == Input || NULL == Output) && 0 != Count))
+    {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    /* Small inputs are not worth the scheduling overhead. */
+    if (TpAlgoRunSerially(ThreadPool, Count))
+    {
+        TpAlgoScanRange(Input, Output, Count, 0);
+        return STATUS_SUCCESS;
+    }
+
+    UINT32 chunkCount = TpAlgoChunkCount(ThreadPool, Count);
+    TP_ALGO_CHUNK* chunks = TpAlgoAllocateChunks(chunkCount, Input, Output, Count);
+    if (NULL == chunks)
+    {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    /* First pass: the sum of every chunk. */
+    status = TpAlgoRunBatch(ThreadPool, TpAlgoReduceRoutine, chunks, chunkCount);
+    if (!NT_SUCCESS(status))
+    {
+        goto CleanUp;
+    }
+
+    /* Turn the chunk sums into the starting offset of every chunk (exclusive scan). */
+    {
+        LONG64 offset = 0;
+        for (UINT32 i = 0; i < chunkCount; ++i)
+        {
+            LONG64 chunkSum = chunks[i].Value;
+            chunks[i].Value = offset;
+            offset += chunkSum;
+        }
+    }
+
+    /* Second pass: every chunk scans its own slice starting from its offset. */
+    status = TpAlgoRunBatch(ThreadPool, TpAlgoScanRoutine, chunks, chunkCount);
+
+CleanUp:
+    free(chunks);
+    return status;
+}
+
+NTSTATUS
+TpParallelSort(
+    _Inout_ MY_THREAD_POOL* ThreadPool,
+    _Inout_updates_(Count) LONG64* Data,
+    _In_ SIZE_T Count
+)
+{
+    NTSTATUS status = STATUS_UNSUCCESSFUL;
+    HRESULT hRes = 0;
+    SIZE_T requiredSizeForBuffer = 0;
+    LONG64* buffer = NULL;
+    SIZE_T* runOffsets = NULL;
+    TP_ALGO_CHUNK* chunks = NULL;
+    TP_ALGO_CHUNK* slices = NULL;
+    UINT32 chunkCount = 0;
+
+    /* Sanity checks for parameters. */
+    if (NULL == ThreadPool || (NULL == Data && 0 != Count))
+    {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    /* Small inputs are not worth the scheduling overhead. */
+    if (TpAlgoRunSerially(ThreadPool, Count))
+    {
+        std::sort(Data, Data + Count);
+        return STATUS_SUCCESS;
+    }
+
+    /* Merging needs a scratch buffer as large as the input. */
+    hRes = SIZETMult(sizeof(LONG64), Count, &requiredSizeForBuffer);
+    if (!SUCCEEDED(hRes))
+    {
+        return STATUS_INTEGER_OVERFLOW;
+    }
+    buffer = (LONG64*)malloc(requiredSizeForBuffer);
+    if (NULL == buffer)
+    {
+        status = STATUS_INSUFFICIENT_RESOURCES;
+        goto CleanUp;
+    }
+
+    chunkCount = TpAlgoChunkCount(ThreadPool, Count);
+    chunks = TpAlgoAllocateChunks(chunkCount, NULL, Data, Count);
+    runOffsets = (SIZE_T*)malloc((chunkCount + 1) * sizeof(SIZE_T));
+    /* Every merge level is cut into at most chunkCount slices plus one per pair of runs. */
+    slices = (TP_ALGO_CHUNK*)malloc(2 * chunkCount * sizeof(TP_ALGO_CHUNK));
+    if (NULL == chunks || NULL == runOffsets || NULL == slices)
+    {
+        status = STATUS_INSUFFICIENT_RESOURCES;
+        goto CleanUp;
+    }
+
+    /* Remember where every sorted run starts. */
+    runOffsets[0] = 0;
+    for (UINT32 i = 0; i < chunkCount; ++i)
+    {
+        runOffsets[i + 1] = runOffsets[i] + chunks[i].Count;
+    }
+
+    /* Sort every chunk in place. */
+    status = TpAlgoRunBatch(ThreadPool, TpAlgoSortRoutine, chunks, chunkCount);
+    if (!NT_SUCCESS(status))
+    {
+        goto CleanUp;
+    }
+
+    /*
+     * Merge neighbouring runs pairwise, ping-ponging between Data and buffer until one run is left.
+     * Every merge is cut into slices of about Count / chunkCount output elements, so each level
+     * keeps the whole pool busy even when only one pair of runs is left.
+     */
+    {
+        LONG64* source = Data;
+        LONG64* destination = buffer;
+        UINT32 runCount = chunkCount;
+        SIZE_T sliceSize = (Count + chunkCount - 1) / chunkCount;
+
+        while (runCount > 1)
+        {
+            UINT32 mergeCount = (runCount + 1) / 2;
+            UINT32 sliceCount = 0;
+
+            for (UINT32 i = 0; i < mergeCount; ++i)
+            {
+                SIZE_T leftStart = runOffsets[2 * i];
+                SIZE_T leftEnd = runOffsets[2 * i + 1];
+                SIZE_T rightEnd = (2 * i + 2 <= runCount) ? runOffsets[2 * i + 2] : leftEnd;
+
+                sliceCount += TpAlgoSliceMerge(source + leftStart, leftEnd - leftStart,
+                                               source + leftEnd, rightEnd - leftEnd,
+                                               destination + leftStart, sliceSize,
+                                               &slices[sliceCount]);
+            }
+
+            status = TpAlgoRunBatch(ThreadPool, TpAlgoMergeRoutine, slices, sliceCount);
+            if (!NT_SUCCESS(status))
+            {
+                goto CleanUp;
+            }
+
+            /* The merged runs start where every other old run started. */
+            for (UINT32 i = 0; i < mergeCount; ++i)
+            {
+                runOffsets[i] = runOffsets[2 * i];
+            }
+            runOffsets[mergeCount] = Count;
+            runCount = mergeCount;
+
+            LONG64* swap = source;
+            source = destination;
+            destination = swap;
+        }
+
+        /* The result must end up in the caller's array. Copy it back in parallel as well. */
+        if (source != Data)
+        {
+            UINT32 sliceCount = TpAlgoSliceMerge(source, Count, NULL, 0, Data, sliceSize, slices);
+
+            status = TpAlgoRunBatch(ThreadPool, TpAlgoMergeRoutine, slices, sliceCount);
+            if (!NT_SUCCESS(status))
+            {
+                goto CleanUp;
+            }
+        }
+    }
+
+    status = STATUS_SUCCESS;
+
+CleanUp:
+    free(slices);
+    free(runOffsets);
+    free(chunks);
+    free(buffer);
+    return status;
+}
+
+NTSTATUS
+TpParallelTransform(
+    _Inout_ MY_THREAD_POOL* ThreadPool,
+    _In_reads_(Count) const LONG64* Input,
+    _Out_writes_(Count) LONG64* Output,
+    _In_ SIZE_T Count,
+    _In_ TP_TRANSFORM_ROUTINE TransformRoutine,
+    _In_opt_ PVOID Context
+)
+{
+    NTSTATUS status = STATUS_UNSUCCESSFUL;
+
+    /* Sanity checks for parameters. */
+    if (NULL == ThreadPool || NULL == TransformRoutine || ((NULL == Input || NULL == Output) && 0 != Count))
+    {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    /* Small inputs are not worth the scheduling overhead. */
+    if (TpAlgoRunSerially(ThreadPool, Count))
+    {
+        TransformRoutine(Input, Output, Count, Context);
+        return STATUS_SUCCESS;
+    }
+
+    UINT32 chunkCount = TpAlgoChunkCount(ThreadPool, Count);
+    TP_ALGO_CHUNK* chunks = TpAlgoAllocateChunks(chunkCount, Input, Output, Count);
+    if (NULL == chunks)
+    {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    /* The routine gets whole contiguous slices, so its inner loop can be vectorized. */
+    for (UINT32 i = 0; i < chunkCount; ++i)
+    {
+        chunks[i].TransformRoutine = TransformRoutine;
+        chunks[i].Context = Context;
+    }
+
+    status = TpAlgoRunBatch(ThreadPool, TpAlgoTransformRoutine, chunks, chunkCount);
+
+    free(chunks);
+    return status;
+}
@@ -0,0 +1,28 @@
+#ifndef TPALGORITHMS_H
+#define TPALGORITHMS_H
+
+#include "threadpool.h"
+
+// **********************************************************
+// *                   TP ALGORITHMS API                    *
+// **********************************************************
+
+// Below this many elements the algorithms run serially on the calling thread.
+#define TP_ALGO_SERIAL_CUTOFF   16384
+
+// Minimum number of elements handed to a single work item.
+#define TP_ALGO_MIN_CHUNK       4096
+
+// TP_TRANSFORM_ROUTINE - Transforms Count contiguous elements from Input into Output.
+typedef void (*TP_TRANSFORM_ROUTINE)(_In_reads_(Count) const LONG64* Input,
+                                     _Out_writes_(Count) LONG64* Output,
+                                     _In_ SIZE_T Count,
+                                     _In_opt_ PVOID Context);
+
+// The calling thread blocks until the algorithm completes. Do not call these from a work routine.
+NTSTATUS TpParallelReduce(_Inout_ MY_THREAD_POOL* ThreadPool, _In_reads_(Count) const LONG64* Data, _In_ SIZE_T Count, _Out_ LONG64* Sum);
+NTSTATUS TpParallelScan(_Inout_ MY_THREAD_POOL* ThreadPool, _In_reads_(Count) const LONG64* Input, _Out_writes_(Count) LONG64* Output, _In_ SIZE_T Count);
+NTSTATUS TpParallelSort(_Inout_ MY_THREAD_POOL* ThreadPool, _Inout_updates_(Count) LONG64* Data, _In_ SIZE_T Count);
+NTSTATUS TpParallelTransform(_Inout_ MY_THREAD_POOL* ThreadPool, _In_reads_(Count) const LONG64* Input, _Out_writes_(Count) LONG64* Output, _In_ SIZE_T Count, _In_ TP_TRANSFORM_ROUTINE TransformRoutine, _In_opt_ PVOID Context);
+
+#endif // TPALGORITHMS_H
@@ -0,0 +1,413 @@
+#include "tppipeline.h"
+
+
+//
+// **********************************************************
+// *                   TP PIPELINE API                      *
+// **********************************************************
+//
+
+struct _TP_PIPELINE;
+
+//
+// TP_PIPELINE_CHUNK - one slot of the in-flight window, reused for every MaxInFlight-th chunk
+//
+typedef struct _TP_PIPELINE_CHUNK
+{
+    /* Pipeline this chunk belongs to. */
+    struct _TP_PIPELINE* Pipeline;
+    /* Position of the chunk in the input. The sink writes chunks in this order. */
+    UINT64 Sequence;
+    /* Input data - points into InputBuffer, or into the mapped view of the file. */
+    const BYTE* Input;
+    SIZE_T InputSize;
+    /* Recycled fixed-size buffers. InputBuffer is NULL when the input is memory mapped. */
+    BYTE* InputBuffer;
+    BYTE* OutputBuffer;
+    SIZE_T OutputSize;
+    /* Result of the transform. */
+    NTSTATUS Status;
+    /* Set when the transform finished and the chunk waits for the sink. */
+    bool Ready;
+} TP_PIPELINE_CHUNK;
+
+//
+// TP_PIPELINE - state shared by the source, transform and sink stages
+//
+typedef struct _TP_PIPELINE
+{
+    const TP_PIPELINE_CONFIG* Config;
+    SIZE_T OutputChunkSize;
+    /* Counts free chunk slots - bounds the number of chunks in flight. */
+    HANDLE SlotsAvailable;
+    /* MaxInFlight slots, chunk N lives in slot N % MaxInFlight. */
+    TP_PIPELINE_CHUNK* Chunks;
+    /* Sink state, protected by SinkLock. */
+    MY_PROFILED_LOCK SinkLock;
+    UINT64 NextToWrite;
+    /* Set while one thread is writing chunks. Only that thread touches OutputFile and BytesWritten. */
+    bool WriterActive;
+    HANDLE OutputFile;
+    UINT64 BytesWritten;
+    /* First failure of any stage. */
+    volatile LONG Status;
+} TP_PIPELINE;
+
+static void
+TpPipelineSetStatus(
+    _Inout_ TP_PIPELINE* Pipeline,
+    _In_ NTSTATUS Status
+)
+{
+    /* Keep the first failure, it is the interesting one. */
+    InterlockedCompareExchange(&Pipeline->Status, Status, STATUS_SUCCESS);
+}
+
+static void
+TpPipelineWriteChunk(
+    _Inout_ TP_PIPELINE* Pipeline,
+    _In_ const TP_PIPELINE_CHUNK* Chunk
+)
+{
+    /* Only the writer calls this, so BytesWritten needs no lock. */
+    if (!NT_SUCCESS(Chunk->Status))
+    {
+        TpPipelineSetStatus(Pipeline, Chunk->Status);
+    }
+    else if (NT_SUCCESS(Pipeline->Status) && 0 != Chunk->OutputSize)
+    {
+        DWORD bytesWritten = 0;
+        if (!WriteFile(Pipeline->OutputFile, Chunk->OutputBuffer, (DWORD)Chunk->OutputSize, &bytesWritten, NULL) ||
+            bytesWritten != Chunk->OutputSize)
+        {
+            printf("TpPipelineWriteChunk: Failed to write chunk %llu. Error: %d\n", Chunk->Sequence, GetLastError());
+            TpPipelineSetStatus(Pipeline, STATUS_UNEXPECTED_IO_ERROR);
+        }
+        else
+        {
+            Pipeline->BytesWritten += bytesWritten;
+        }
+    }
+}
+
+static void
+TpPipelineSink(
+    _Inout_ TP_PIPELINE* Pipeline,
+    _Inout_ TP_PIPELINE_CHUNK* Chunk
+)
+{
+    /*
+     * Marks Chunk ready. If nobody is writing, this thread becomes the writer and writes every
+     * ready chunk that is next in sequence, giving its slot back to the source. The lock is only
+     * held to look at the window - never across WriteFile - so other completers return at once.
+     * Slots are freed in sequence order, so slot NextToWrite % MaxInFlight always holds chunk NextToWrite.
+     */
+    ProfiledLockAcquireExclusive(&Pipeline->SinkLock);
+
+    Chunk->Ready = true;
+    if (Pipeline->WriterActive)
+    {
+        /* The writer will find the chunk when it gets to it. */
+        ProfiledLockReleaseExclusive(&Pipeline->SinkLock);
+        return;
+    }
+    Pipeline->WriterActive = true;
+
+    while (true)
+    {
+        TP_PIPELINE_CHUNK* next = &Pipeline->Chunks[Pipeline->NextToWrite % Pipeline->Config->MaxInFlight];
+        if (!next->Ready)
+        {
+            /* Checked under the lock, so a chunk made ready after this is written by its own completer. */
+            Pipeline->WriterActive = false;
+            break;
+        }
+        assert(next->Sequence == Pipeline->NextToWrite);
+
+        ProfiledLockReleaseExclusive(&Pipeline->SinkLock);
+        TpPipelineWriteChunk(Pipeline, next);
+        ProfiledLockAcquireExclusive(&Pipeline->SinkLock);
+
+        next->Ready = false;
+        Pipeline->NextToWrite++;
+        ReleaseSemaphore(Pipeline->SlotsAvailable, 1, NULL);
+    }
+
+    ProfiledLockReleaseExclusive(&Pipeline->SinkLock);
+}
+
+static NTSTATUS
+TpPipelineRunTransform(
+    _Inout_ TP_PIPELINE* Pipeline,
+    _Inout_ TP_PIPELINE_CHUNK* Chunk
+)
+{
+    /* A read error on a mapped view surfaces as an in-page exception on whichever thread touches the page. */
+    __try
+    {
+        return Pipeline->Config->TransformRoutine(Chunk->Input,
+                                                  Chunk->InputSize,
+                                                  Chunk->OutputBuffer,
+                                                  Pipeline->OutputChunkSize,
+                                                  &Chunk->OutputSize,
+                                                  Pipeline->Config->Context);
+    }
+    __except (EXCEPTION_IN_PAGE_ERROR == GetExceptionCode() ? EXCEPTION_EXECUTE_HANDLER : EXCEPTION_CONTINUE_SEARCH)
+    {
+        Chunk->OutputSize = 0;
+        return STATUS_IN_PAGE_ERROR;
+    }
+}
+
+static DWORD WINAPI
+TpPipelineTransformRoutine(
+    _In_opt_ PVOID Context
+)
+{
+    TP_PIPELINE_CHUNK* chunk = (TP_PIPELINE_CHUNK*)(Context);
+    TP_PIPELINE* pipeline = chunk->Pipeline;
+
+    /* Don't waste time on chunks that will not be written anyway. */
+    chunk->OutputSize = 0;
+    chunk->Status = pipeline->Status;
+    if (NT_SUCCESS(chunk->Status))
+    {
+        chunk->Status = TpPipelineRunTransform(pipeline, chunk);
+        if (NT_SUCCESS(chunk->Status) && chunk->OutputSize > pipeline->OutputChunkSize)
+        {
+            chunk->Status = STATUS_BUFFER_OVERFLOW;
+        }
+    }
+
+    /* Hand the chunk to the sink. */
+    TpPipelineSink(pipeline, chunk);
+
+    return STATUS_SUCCESS;
+}
+
+void
+TpPipelineInitConfig(
+    _Out_ TP_PIPELINE_CONFIG* Config,
+    _In_ TP_PIPELINE_TRANSFORM_ROUTINE TransformRoutine,
+    _In_opt_ PVOID Context
+)
+{
+    RtlZeroMemory(Config, sizeof(TP_PIPELINE_CONFIG));
+
+    Config->ChunkSize = TP_PIPELINE_DEFAULT_CHUNK_SIZE;
+    Config->OutputChunkSize = 0;
+    Config->MaxInFlight = TP_PIPELINE_DEFAULT_MAX_IN_FLIGHT;
+    Config->UseMemoryMapping = true;
+    Config->TransformRoutine = TransformRoutine;
+    Config->Context = Context;
+}
+
+NTSTATUS
+TpPipelineProcessFile(
+    _Inout_ MY_THREAD_POOL* ThreadPool,
+    _In_ PCWSTR InputPath,
+    _In_ PCWSTR OutputPath,
+    _In_ const TP_PIPELINE_CONFIG* Config,
+    _Out_opt_ TP_PIPELINE_STATS* Stats
+)
+{
+    NTSTATUS status = STATUS_UNSUCCESSFUL;
+    HRESULT hRes = 0;
+    TP_PIPELINE pipeline;
+    HANDLE inputFile = INVALID_HANDLE_VALUE;
+    HANDLE inputMapping = NULL;
+    const BYTE* inputView = NULL;
+    LARGE_INTEGER inputSize = { 0 };
+    SIZE_T requiredSizeForChunks = 0;
+    SIZE_T requiredSizeForInput = 0;
+    SIZE_T requiredSizeForOutput = 0;
+    BYTE* inputBuffers = NULL;
+    BYTE* outputBuffers = NULL;
+    UINT64 offset = 0;
+    UINT64 sequence = 0;
+    UINT32 slotsAcquired = 0;
+
+    /* Sanity checks for parameters. */
+    if (NULL == ThreadPool || NULL == InputPath || NULL == OutputPath || NULL == Config ||
+        NULL == Config->TransformRoutine || 0 == Config->MaxInFlight || Config->MaxInFlight > MAXLONG ||
+        0 == Config->ChunkSize || Config->ChunkSize > MAXDWORD || Config->OutputChunkSize > MAXDWORD)
+    {
+        return STATUS_INVALID_PARAMETER;
+    }
+    if (NULL != Stats)
+    {
+        RtlZeroMemory(Stats, sizeof(TP_PIPELINE_STATS));
+    }
+
+    RtlZeroMemory(&pipeline, sizeof(pipeline));
+    pipeline.Config = Config;
+    pipeline.OutputChunkSize = (0 != Config->OutputChunkSize) ? Config->OutputChunkSize : Config->ChunkSize;
+    pipeline.OutputFile = INVALID_HANDLE_VALUE;
+    pipeline.Status = STATUS_SUCCESS;
+    ProfiledLockInitialize(&pipeline.SinkLock);
+
+    /* Open both ends of the pipeline. */
+    inputFile = CreateFileW(InputPath, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (INVALID_HANDLE_VALUE == inputFile)
+    {
+        printf("TpPipelineProcessFile: Failed to open input. Error: %d\n", GetLastError());
+        status = STATUS_INVALID_HANDLE;
+        goto CleanUp;
+    }
+    if (!GetFileSizeEx(inputFile, &inputSize))
+    {
+        status = STATUS_UNEXPECTED_IO_ERROR;
+        goto CleanUp;
+    }
+    pipeline.OutputFile = CreateFileW(OutputPath, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (INVALID_HANDLE_VALUE == pipeline.OutputFile)
+    {
+        printf("TpPipelineProcessFile: Failed to create output. Error: %d\n", GetLastError());
+        status = STATUS_INVALID_HANDLE;
+        goto CleanUp;
+    }
+
+    /* Map the whole input if we can. Empty files and views that do not fit the address space fall back to reads. */
+    if (Config->UseMemoryMapping && 0 != inputSize.QuadPart && (UINT64)inputSize.QuadPart <= (SIZE_T)-1)
+    {
+        inputMapping = CreateFileMappingW(inputFile, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (NULL != inputMapping)
+        {
+            inputView = (const BYTE*)MapViewOfFile(inputMapping, FILE_MAP_READ, 0, 0, 0);
+        }
+    }
+
+    /* Allocate the slots and the recycled buffers for all of them at once. */
+    hRes = SIZETMult(sizeof(TP_PIPELINE_CHUNK), Config->MaxInFlight, &requiredSizeForChunks);
+    if (SUCCEEDED(hRes))
+    {
+        hRes = SIZETMult(Config->ChunkSize, Config->MaxInFlight, &requiredSizeForInput);
+    }
+    if (SUCCEEDED(hRes))
+    {
+        hRes = SIZETMult(pipeline.OutputChunkSize, Config->MaxInFlight, &requiredSizeForOutput);
+    }
+    if (!SUCCEEDED(hRes))
+    {
+        status = STATUS_INTEGER_OVERFLOW;
+        goto CleanUp;
+    }
+
+    pipeline.Chunks = (TP_PIPELINE_CHUNK*)malloc(requiredSizeForChunks);
+    if (NULL == pipeline.Chunks)
+    {
+        status = STATUS_INSUFFICIENT_RESOURCES;
+        goto CleanUp;
+    }
+    RtlZeroMemory(pipeline.Chunks, requiredSizeForChunks);
+
+    if (NULL == inputView)
+    {
+        inputBuffers = (BYTE*)malloc(requiredSizeForInput);
+    }
+    outputBuffers = (BYTE*)malloc(requiredSizeForOutput);
+    if ((NULL == inputView && NULL == inputBuffers) || NULL == outputBuffers)
+    {
+        status = STATUS_INSUFFICIENT_RESOURCES;
+        goto CleanUp;
+    }
+
+    for (UINT32 i = 0; i < Config->MaxInFlight; ++i)
+    {
+        pipeline.Chunks[i].Pipeline = &pipeline;
+        pipeline.Chunks[i].InputBuffer = (NULL != inputBuffers) ? inputBuffers + i * Config->ChunkSize : NULL;
+        pipeline.Chunks[i].OutputBuffer = outputBuffers + i * pipeline.OutputChunkSize;
+    }
+
+    pipeline.SlotsAvailable = CreateSemaphoreW(NULL, (LONG)Config->MaxInFlight, (LONG)Config->MaxInFlight, NULL);
+    if (NULL == pipeline.SlotsAvailable)
+    {
+        status = STATUS_INVALID_HANDLE;
+        goto CleanUp;
+    }
+
+    /* Source stage: cut the input into chunks and feed them to the pool, at most MaxInFlight at a time. */
+    while (offset < (UINT64)inputSize.QuadPart && NT_SUCCESS(pipeline.Status))
+    {
+        /* Wait for the sink to give back a slot. */
+        WaitForSingleObject(pipeline.SlotsAvailable, INFINITE);
+
+        TP_PIPELINE_CHUNK* chunk = &pipeline.Chunks[sequence % Config->MaxInFlight];
+        UINT64 remaining = (UINT64)inputSize.QuadPart - offset;
+        SIZE_T chunkSize = (remaining < Config->ChunkSize) ? (SIZE_T)remaining : Config->ChunkSize;
+
+        if (NULL != inputView)
+        {
+            chunk->Input = inputView + offset;
+        }
+        else
+        {
+            DWORD bytesRead = 0;
+            if (!ReadFile(inputFile, chunk->InputBuffer, (DWORD)chunkSize, &bytesRead, NULL) || 0 == bytesRead)
+            {
+                printf("TpPipelineProcessFile: Failed to read chunk %llu. Error: %d\n", sequence, GetLastError());
+                TpPipelineSetStatus(&pipeline, STATUS_UNEXPECTED_IO_ERROR);
+                ReleaseSemaphore(pipeline.SlotsAvailable, 1, NULL);
+                break;
+            }
+            chunk->Input = chunk->InputBuffer;
+            chunkSize = bytesRead;
+        }
+        chunk->InputSize = chunkSize;
+        chunk->Sequence = sequence;
+
+        /* If the pool cannot take the chunk, transform it here. The sink still sees it in order. */
+        if (!NT_SUCCESS(TpEnqueueWorkItem(ThreadPool, TpPipelineTransformRoutine, chunk)))
+        {
+            TpPipelineTransformRoutine(chunk);
+        }
+
+        offset += chunkSize;
+        sequence++;
+    }
+
+    /* Drain: once every slot is back, every chunk went through the sink. */
+    for (; slotsAcquired < Config->MaxInFlight; ++slotsAcquired)
+    {
+        WaitForSingleObject(pipeline.SlotsAvailable, INFINITE);
+    }
+
+    /* The writer that freed the last slot may still be inside the sink. Wait for it before the pipeline goes away. */
+    ProfiledLockAcquireExclusive(&pipeline.SinkLock);
+    ProfiledLockReleaseExclusive(&pipeline.SinkLock);
+
+    status = pipeline.Status;
+    if (NULL != Stats)
+    {
+        Stats->Chunks = sequence;
+        Stats->BytesRead = offset;
+        Stats->BytesWritten = pipeline.BytesWritten;
+        Stats->MemoryMapped = (NULL != inputView);
+    }
+
+CleanUp:
+    if (NULL != pipeline.SlotsAvailable)
+    {
+        CloseHandle(pipeline.SlotsAvailable);
+    }
+    free(outputBuffers);
+    free(inputBuffers);
+    free(pipeline.Chunks);
+    if (NULL != inputView)
+    {
+        UnmapViewOfFile(inputView);
+    }
+    if (NULL != inputMapping)
+    {
+        CloseHandle(inputMapping);
+    }
+    if (INVALID_HANDLE_VALUE != pipeline.OutputFile)
+    {
+        CloseHandle(pipeline.OutputFile);
+    }
+    if (INVALID_HANDLE_VALUE != inputFile)
+    {
+        CloseHandle(inputFile);
+    }
+    return status;
+}
@@ -0,0 +1,44 @@
+#ifndef TPPIPELINE_H
+#define TPPIPELINE_H
+
+#include "threadpool.h"
+
+// **********************************************************
+// *                   TP PIPELINE API                      *
+// **********************************************************
+
+#define TP_PIPELINE_DEFAULT_CHUNK_SIZE      (1024 * 1024)
+#define TP_PIPELINE_DEFAULT_MAX_IN_FLIGHT   8
+
+// TP_PIPELINE_TRANSFORM_ROUTINE - Transforms one input chunk into at most OutputCapacity bytes.
+typedef NTSTATUS (*TP_PIPELINE_TRANSFORM_ROUTINE)(_In_reads_bytes_(InputSize) const BYTE* Input,
+                                                  _In_ SIZE_T InputSize,
+                                                  _Out_writes_bytes_(OutputCapacity) BYTE* Output,
+                                                  _In_ SIZE_T OutputCapacity,
+                                                  _Out_ SIZE_T* OutputSize,
+                                                  _In_opt_ PVOID Context);
+
+// TP_PIPELINE_CONFIG - How a file is split and transformed
+typedef struct _TP_PIPELINE_CONFIG {
+    SIZE_T ChunkSize;
+    SIZE_T OutputChunkSize;
+    UINT32 MaxInFlight;
+    bool UseMemoryMapping;
+    TP_PIPELINE_TRANSFORM_ROUTINE TransformRoutine;
+    PVOID Context;
+} TP_PIPELINE_CONFIG;
+
+// TP_PIPELINE_STATS - What a pipeline run did
+typedef struct _TP_PIPELINE_STATS {
+    UINT64 Chunks;
+    UINT64 BytesRead;
+    UINT64 BytesWritten;
+    bool MemoryMapped;
+} TP_PIPELINE_STATS;
+
+void TpPipelineInitConfig(_Out_ TP_PIPELINE_CONFIG* Config, _In_ TP_PIPELINE_TRANSFORM_ROUTINE TransformRoutine, _In_opt_ PVOID Context);
+
+// The calling thread is the source stage and blocks until the output is written. Do not call it from a work routine.
+NTSTATUS TpPipelineProcessFile(_Inout_ MY_THREAD_POOL* ThreadPool, _In_ PCWSTR InputPath, _In_ PCWSTR OutputPath, _In_ const TP_PIPELINE_CONFIG* Config, _Out_opt_ TP_PIPELINE_STATS* Stats);
+
+#endif // TPPIPELINE_H